@@ -22,8 +22,28 @@ enum qrgen_QR_module_values {
   QRGEN_EMPTY = 255
 };
 
+struct qrgen_reference_frame {
+  // previously displayed code, used to bias masking selection towards fewer changed modules
+  const unsigned char * data;
+  unsigned char version;
+  unsigned tolerance;
+};
+
+enum qrgen_sliced_penalty_events {
+  // events counted by the bit-sliced masking score computation, which are later converted into penalties
+  QRGEN_EVENT_RUN_MODULES = 0, // modules from the 7th onwards in a run of modules of the same color
+  QRGEN_EVENT_RUNS = 1,        // runs of 7 or more modules
+  QRGEN_EVENT_PATTERNS = 2,
+  QRGEN_EVENT_BLOCKS = 3,
+  QRGEN_EVENT_BLACK = 4,
+  QRGEN_EVENT_COUNT = 5
+};
+
 #define QRGEN_MASKING_OFFSET 5
 
+static unsigned char qrgen_generate_QR_code(const unsigned char *, unsigned short, unsigned char, unsigned char,
+                                            const struct qrgen_reference_frame *, unsigned char *);
+static unsigned char qrgen_encode_and_select(const unsigned char *, unsigned short, unsigned char, unsigned char, unsigned char *, unsigned short *);
 static unsigned short qrgen_encode_data(unsigned char *, const unsigned char *, unsigned short, unsigned char);
 static unsigned char qrgen_select_parameters(const unsigned short *, unsigned char, unsigned char, int);
 static unsigned char qrgen_select_parameters_for_kind(unsigned short, unsigned char, unsigned char, int);
@@ -32,15 +52,17 @@ static unsigned short qrgen_maximum_data_length(unsigned char, unsigned char);
 static unsigned short qrgen_data_bits_for_version(unsigned char);
 static unsigned char qrgen_alignment_pattern_count(unsigned char);
 static unsigned char qrgen_alignment_pattern_position(unsigned char, unsigned char);
-static int qrgen_generate_QR(const unsigned char *, unsigned short, unsigned char, unsigned char, unsigned char *);
+static int qrgen_generate_QR(const unsigned char *, unsigned short, unsigned char, unsigned char, const struct qrgen_reference_frame *, unsigned char *);
 static int qrgen_encode_QR_data(const unsigned char *, unsigned short, unsigned char, unsigned char, unsigned char *);
+static int qrgen_fill_data_stream(const unsigned char *, unsigned short, unsigned short, unsigned char *);
 static struct qrgen_ECC_parameters qrgen_calculate_ECC_parameters(unsigned char, unsigned char);
 static void qrgen_generate_ECC_stream(const unsigned char *, unsigned char *, struct qrgen_ECC_parameters);
 static void qrgen_generate_ECC_data(const unsigned char *, unsigned char, unsigned char *, unsigned char);
 static void qrgen_generate_ECC_polynomial(unsigned char, unsigned char *);
 static unsigned char qrgen_ECC_multiply(unsigned char, unsigned char);
 static void qrgen_interleave(const unsigned char *, const unsigned char *, struct qrgen_ECC_parameters, unsigned char *);
-static int qrgen_build_QR(const unsigned char *, unsigned char, unsigned char, unsigned char *);
+static int qrgen_build_QR(const unsigned char *, unsigned char, unsigned char, const struct qrgen_reference_frame *, unsigned char *);
+static void qrgen_place_fixed_patterns(unsigned char *, unsigned char, unsigned char);
 static void qrgen_place_function_patterns(unsigned char *, unsigned char, unsigned char);
 static void qrgen_place_position_identification_pattern(unsigned char *, unsigned char, unsigned char, unsigned char);
 static void qrgen_place_alignment_patterns(unsigned char *, unsigned char, unsigned char);
@@ -51,14 +73,53 @@ static unsigned short qrgen_compute_format_information(unsigned char, unsigned c
 static void qrgen_place_data_modules(unsigned char *, unsigned char, unsigned char, const unsigned char *);
 static unsigned short qrgen_scan_index(unsigned short, unsigned char);
 static unsigned char qrgen_select_masking(unsigned char *, unsigned char, unsigned char);
+static unsigned char qrgen_select_masking_for_reference(unsigned char *, unsigned char, unsigned char, const struct qrgen_reference_frame *);
+static unsigned qrgen_count_changed_modules(const unsigned char *, const unsigned char *, unsigned char);
 static void qrgen_apply_masking(unsigned char *, unsigned char, unsigned char, unsigned char);
 static unsigned qrgen_compute_masking_score(unsigned char *, unsigned char, unsigned char);
+static unsigned qrgen_finish_masking_score(unsigned, unsigned char);
 static void qrgen_unmask(unsigned char *, unsigned char);
 static void qrgen_export_QR_data(const unsigned char *, unsigned char, unsigned char *);
+static void qrgen_render_sheet_row(const unsigned char *, const unsigned char *, unsigned, unsigned, struct QR_sheet_layout, unsigned char *);
+static void qrgen_fill_pixels(unsigned char *, unsigned long, unsigned long);
+static void qrgen_load_display_row(const unsigned char *, unsigned char, unsigned char, unsigned char, unsigned char *);
+static unsigned char qrgen_load_display_difference(const unsigned char *, unsigned char, const unsigned char *, unsigned char, unsigned char,
+                                                   unsigned char *);
+static unsigned char qrgen_next_changed_run(const unsigned char *, unsigned char, unsigned char *, unsigned char *);
+static int qrgen_tile_is_dirty(const unsigned char *, unsigned char, unsigned char, unsigned char);
+static int qrgen_generate_sliced_QR_codes(const void * const *, const unsigned short *, const unsigned *, unsigned char, unsigned char, unsigned char,
+                                          unsigned char, void * const *);
+static int qrgen_encode_sliced_QR_data(const void * const *, const unsigned short *, const unsigned *, unsigned char, unsigned char, unsigned char,
+                                       unsigned char, unsigned char, unsigned long long *, unsigned long long *);
+static void qrgen_generate_sliced_ECC_stream(const unsigned long long *, unsigned long long *, struct qrgen_ECC_parameters);
+static void qrgen_generate_sliced_ECC_data(const unsigned long long *, unsigned char, unsigned long long *, unsigned char, unsigned char (*)[8]);
+static void qrgen_interleave_sliced(const unsigned long long *, const unsigned long long *, struct qrgen_ECC_parameters, unsigned long long *);
+static int qrgen_build_sliced_QR(const unsigned long long *, unsigned char, unsigned char, unsigned char, unsigned long long *, void * const *,
+                                 const unsigned *);
+static void qrgen_place_sliced_data_modules(unsigned char *, unsigned long long *, unsigned char, unsigned char, const unsigned long long *);
+static void qrgen_select_sliced_masking(const unsigned char *, unsigned char *, const unsigned long long *, unsigned long long *, unsigned char,
+                                        unsigned char, unsigned char, unsigned long long *);
+static void qrgen_apply_sliced_masking(const unsigned char *, const unsigned long long *, unsigned char, unsigned long long, unsigned long long *);
+static void qrgen_compute_sliced_masking_scores(const unsigned long long *, unsigned char, unsigned char, unsigned char, unsigned char *);
+static void qrgen_count_sliced_line_penalties(const unsigned long long *, const unsigned long long *, unsigned short, unsigned char, int,
+                                              unsigned long long (*)[16]);
+static void qrgen_add_to_sliced_counter(unsigned long long *, unsigned long long);
+static unsigned qrgen_read_sliced_counter(const unsigned long long *, unsigned char);
+static void qrgen_export_sliced_QR_data(const unsigned long long *, unsigned char, void * const *, const unsigned *, unsigned char);
+static void qrgen_transpose_sliced_block(unsigned long long *);
 
 // anything going over this limit just doesn't fit; fail and exit
 #define QRGEN_ENCODING_BUFFER_SIZE 4096
 
+// number of codes generated together by the bit-sliced path: one per bit of an unsigned long long (bits beyond 64 are unused)
+#define QRGEN_SLICED_LANES 64
+#define QRGEN_ALL_SLICED_LANES 0xFFFFFFFFFFFFFFFFULL
+// below this many codes with the same parameters, generating them one by one is faster
+#define QRGEN_SLICED_MINIMUM_LANES 4
+
+// bytes in a row of the largest display area, plus one for spillover when centering codes in it
+#define QRGEN_DISPLAY_ROW_SIZE ((QR_PIXELS_PER_SIDE(40) >> 3) + 2)
+
 #define QRGEN_PARAMS(blocks, ECC_bytes) ((((blocks) & 0xFF) << 8) | ((ECC_bytes) & 0xFF))
 
 static const unsigned short qrgen_error_correction_parameters[] = {
@@ -107,10 +168,185 @@ static const unsigned short qrgen_error_correction_parameters[] = {
 };
 
 unsigned char generate_QR_code (const void * data, unsigned short length, unsigned char target_version, unsigned char limit_version, void * buffer) {
+  return qrgen_generate_QR_code(data, length, target_version, limit_version, NULL, buffer);
+}
+
+unsigned char select_QR_version (const void * data, unsigned short length, unsigned char target_version, unsigned char limit_version) {
+  // returns the version that generate_QR_code would choose for the same arguments, without generating the code
+  unsigned char encoding_buffer[QRGEN_ENCODING_BUFFER_SIZE * 3];
+  unsigned short lengths[3];
+  return qrgen_encode_and_select(data, length, target_version, limit_version, encoding_buffer, lengths) >> 2;
+}
+
+unsigned char generate_QR_code_update (const void * data, unsigned short length, unsigned char target_version, unsigned char limit_version,
+                                       const void * previous, unsigned char previous_version, unsigned tolerance, void * buffer) {
+  if ((previous_version > 40) || (previous_version && !previous)) return 0;
+  if (!previous_version) return qrgen_generate_QR_code(data, length, target_version, limit_version, NULL, buffer);
+  struct qrgen_reference_frame reference = {.data = previous, .version = previous_version, .tolerance = tolerance};
+  return qrgen_generate_QR_code(data, length, target_version, limit_version, &reference, buffer);
+}
+
+unsigned generate_QR_codes (const void * const * data, const unsigned short * lengths, unsigned count, unsigned char target_version,
+                            unsigned char limit_version, void * const * buffers, unsigned char * versions) {
+  // returns the number of codes successfully generated; versions[n] is set to 0 for codes that couldn't be generated
+  // codes that end up with the same version and ECC level are generated together, QRGEN_SLICED_LANES at a time
+  if (!count) return 0;
+  unsigned char encoding_buffer[QRGEN_ENCODING_BUFFER_SIZE * 3];
+  unsigned short encoded_lengths[3];
+  unsigned lanes[QRGEN_SLICED_LANES];
+  unsigned char lane_count, lane;
+  unsigned first, current, generated = 0;
+  unsigned char * selections = malloc(count);
+  if (selections)
+    for (current = 0; current < count; current ++) {
+      selections[current] = qrgen_encode_and_select(data[current], lengths[current], target_version, limit_version, encoding_buffer, encoded_lengths);
+      if (!selections[current]) versions[current] = 0;
+    }
+  for (first = 0; first < count; first ++) {
+    if (!selections) {
+      // if there's no memory to group the codes, just generate them one by one
+      versions[first] = generate_QR_code(data[first], lengths[first], target_version, limit_version, buffers[first]);
+      generated += !!versions[first];
+      continue;
+    }
+    // skip codes that don't fit, or that were already generated along with some earlier code
+    if (!selections[first]) continue;
+    lane_count = 0;
+    for (current = first; (current < count) && (lane_count < QRGEN_SLICED_LANES); current ++)
+      if (selections[current] == selections[first]) lanes[lane_count ++] = current;
+    if ((lane_count < QRGEN_SLICED_MINIMUM_LANES) ||
+        qrgen_generate_sliced_QR_codes(data, lengths, lanes, lane_count, target_version, limit_version, selections[first], buffers))
+      for (lane = 0; lane < lane_count; lane ++)
+        versions[lanes[lane]] = generate_QR_code(data[lanes[lane]], lengths[lanes[lane]], target_version, limit_version, buffers[lanes[lane]]);
+    else
+      for (lane = 0; lane < lane_count; lane ++) versions[lanes[lane]] = selections[first] >> 2;
+    for (lane = 0; lane < lane_count; lane ++) {
+      generated += !!versions[lanes[lane]];
+      selections[lanes[lane]] = 0;
+    }
+  }
+  free(selections);
+  return generated;
+}
+
+unsigned render_QR_sheet (const void * const * data, const unsigned short * lengths, unsigned count, struct QR_sheet_layout layout,
+                          void (* emit_row) (const void *, void *), void * context, void * buffer) {
+  // returns the number of codes rendered; rendering stops before the first sheet row containing a code that can't be generated
+  if (!(layout.columns && layout.scale && emit_row && buffer)) return 0;
+  if ((layout.target_version < 1) || (layout.target_version > 40) || (layout.limit_version < 1) || (layout.limit_version > 40)) return 0;
+  unsigned char max_version = (layout.target_version > layout.limit_version) ? layout.target_version : layout.limit_version;
+  // buffer layout: one code buffer per column, followed by the versions of those codes, followed by the pixel row
+  unsigned char * codes = buffer;
+  unsigned char * versions = codes + (unsigned long) layout.columns * QR_BUFFER_SIZE(max_version);
+  unsigned char * row = versions + layout.columns;
+  unsigned cell = QR_SHEET_CELL_SIZE(max_version, layout.margin);
+  unsigned first, band, column, line, repeat;
+  for (first = 0; first < count; first += band) {
+    band = count - first;
+    if (band > layout.columns) band = layout.columns;
+    for (column = 0; column < band; column ++) {
+      versions[column] = generate_QR_code(data[first + column], lengths[first + column], layout.target_version, layout.limit_version,
+                                          codes + (unsigned long) column * QR_BUFFER_SIZE(max_version));
+      if (!versions[column]) return first;
+    }
+    for (line = 0; line < cell; line ++) {
+      qrgen_render_sheet_row(codes, versions, band, line, layout, row);
+      for (repeat = 0; repeat < layout.scale; repeat ++) emit_row(row, context);
+    }
+  }
+  return count;
+}
+
+unsigned diff_QR_spans (const void * previous, unsigned char previous_version, const void * next, unsigned char next_version,
+                        struct QR_change * changes, unsigned max_changes) {
+  // returns the number of spans needed to cover all changes; only the first max_changes of them are written
+  if ((previous_version > 40) || (next_version > 40) || (previous_version && !previous) || (next_version && !next)) return 0;
+  unsigned char difference[QRGEN_DISPLAY_ROW_SIZE];
+  unsigned char side = QR_PIXELS_PER_SIDE((previous_version > next_version) ? previous_version : next_version);
+  unsigned char row, col, width;
+  unsigned count = 0;
+  if (!(previous_version || next_version)) return 0;
+  for (row = 0; row < side; row ++) {
+    if (!qrgen_load_display_difference(previous, previous_version, next, next_version, row, difference)) continue;
+    col = 0;
+    while (qrgen_next_changed_run(difference, side, &col, &width)) {
+      if (count < max_changes) changes[count] = (struct QR_change) {.row = row, .col = col, .height = 1, .width = width};
+      count ++;
+      col += width;
+    }
+  }
+  return count;
+}
+
+unsigned diff_QR_rectangles (const void * previous, unsigned char previous_version, const void * next, unsigned char next_version,
+                             unsigned char tile_size, struct QR_change * changes, unsigned max_changes) {
+  // the display is split into tiles of tile_size * tile_size modules; runs of changed tiles in a row of tiles become rectangles,
+  // and rectangles spanning the same columns in consecutive rows of tiles are merged together
+  // returns the number of rectangles needed to cover all changes; only the first max_changes of them are written
+  if ((previous_version > 40) || (next_version > 40) || (previous_version && !previous) || (next_version && !next) || !tile_size) return 0;
+  if (!(previous_version || next_version)) return 0;
+  struct QR_change open[QR_PIXELS_PER_SIDE(40) / 2 + 1], current[QR_PIXELS_PER_SIDE(40) / 2 + 1];
+  unsigned open_indexes[QR_PIXELS_PER_SIDE(40) / 2 + 1], current_indexes[QR_PIXELS_PER_SIDE(40) / 2 + 1];
+  unsigned char difference[QRGEN_DISPLAY_ROW_SIZE], dirty[QRGEN_DISPLAY_ROW_SIZE];
+  unsigned char side = QR_PIXELS_PER_SIDE((previous_version > next_version) ? previous_version : next_version);
+  unsigned char first_row, height, row, col, width, pos;
+  unsigned open_count = 0, current_count, open_pos, count = 0;
+  for (first_row = 0; first_row < side; first_row += height) {
+    height = ((side - first_row) < tile_size) ? side - first_row : tile_size;
+    memset(dirty, 0, sizeof dirty);
+    for (row = first_row; row < (first_row + height); row ++)
+      if (qrgen_load_display_difference(previous, previous_version, next, next_version, row, difference))
+        for (pos = 0; pos < sizeof dirty; pos ++) dirty[pos] |= difference[pos];
+    current_count = open_pos = 0;
+    for (col = 0; col < side; col += width) {
+      // find the next run of dirty tiles in this row of tiles
+      width = 0;
+      while (((col + width) < side) && qrgen_tile_is_dirty(dirty, side, col + width, tile_size))
+        width = ((side - col - width) < tile_size) ? side - col : width + tile_size;
+      if (!width) {
+        width = ((side - col) < tile_size) ? side - col : tile_size;
+        continue;
+      }
+      while ((open_pos < open_count) && (open[open_pos].col < col)) open_pos ++;
+      if ((open_pos < open_count) && (open[open_pos].col == col) && (open[open_pos].width == width)) {
+        current[current_count] = open[open_pos];
+        current[current_count].height += height;
+        current_indexes[current_count] = open_indexes[open_pos];
+      } else {
+        current[current_count] = (struct QR_change) {.row = first_row, .col = col, .height = height, .width = width};
+        current_indexes[current_count] = count ++;
+      }
+      if (current_indexes[current_count] < max_changes) changes[current_indexes[current_count]] = current[current_count];
+      current_count ++;
+    }
+    memcpy(open, current, current_count * sizeof *open);
+    memcpy(open_indexes, current_indexes, current_count * sizeof *open_indexes);
+    open_count = current_count;
+  }
+  return count;
+}
+
+static unsigned char qrgen_generate_QR_code (const unsigned char * data, unsigned short length, unsigned char target_version,
+                                             unsigned char limit_version, const struct qrgen_reference_frame * reference, unsigned char * buffer) {
+  unsigned char encoding_buffer[QRGEN_ENCODING_BUFFER_SIZE * 3];
+  unsigned short lengths[3];
+  unsigned char version = qrgen_encode_and_select(data, length, target_version, limit_version, encoding_buffer, lengths);
+  if (!version) return 0;
+  unsigned char ECC = version & 3;
+  version >>= 2;
+  int rv = qrgen_generate_QR(encoding_buffer + QRGEN_ENCODING_BUFFER_SIZE * ((version > 9) + (version > 26)),
+                             lengths[(version > 9) + (version > 26)], version, ECC, reference, buffer);
+  if (rv) return 0;
+  return version;
+}
+
+static unsigned char qrgen_encode_and_select (const unsigned char * data, unsigned short length, unsigned char target_version,
+                                              unsigned char limit_version, unsigned char * encoding_buffer, unsigned short * lengths) {
+  // returns the selected parameters in the format used by qrgen_select_parameters, or 0 if the data doesn't fit
+  // the encoding buffer must contain room for 3 * QRGEN_ENCODING_BUFFER_SIZE bytes, and lengths for 3 elements
   if ((target_version < 1) || (target_version > 40) || (limit_version < 1) || (limit_version > 40)) return 0;
   if (length && !data) return 0;
-  unsigned char encoding_buffer[QRGEN_ENCODING_BUFFER_SIZE * 3];
-  unsigned short lengths[3] = {0, 0, 0};
+  lengths[0] = lengths[1] = lengths[2] = 0;
   // only encode the kinds we care about
   if ((target_version < 10) || (limit_version < 10))
     *lengths = qrgen_encode_data(encoding_buffer, data, length, 0);
@@ -118,18 +354,10 @@ unsigned char generate_QR_code (const void * data, unsigned short length, unsign
     lengths[1] = qrgen_encode_data(encoding_buffer + QRGEN_ENCODING_BUFFER_SIZE, data, length, 1);
   if ((target_version > 26) || (limit_version > 26))
     lengths[2] = qrgen_encode_data(encoding_buffer + QRGEN_ENCODING_BUFFER_SIZE * 2, data, length, 2);
-  unsigned char version;
   if (target_version < limit_version)
-    version = qrgen_select_parameters(lengths, target_version, limit_version, 0);
+    return qrgen_select_parameters(lengths, target_version, limit_version, 0);
   else
-    version = qrgen_select_parameters(lengths, limit_version, target_version, 1);
-  if (!version) return 0;
-  unsigned char ECC = version & 3;
-  version >>= 2;
-  int rv = qrgen_generate_QR(encoding_buffer + QRGEN_ENCODING_BUFFER_SIZE * ((version > 9) + (version > 26)),
-                             lengths[(version > 9) + (version > 26)], version, ECC, buffer);
-  if (rv) return 0;
-  return version;
+    return qrgen_select_parameters(lengths, limit_version, target_version, 1);
 }
 
 static unsigned short qrgen_encode_data (unsigned char * buffer, const unsigned char * data, unsigned short length, unsigned char kind) {
@@ -222,19 +450,28 @@ static unsigned char qrgen_alignment_pattern_position (unsigned char version, un
   return max - step * (num_steps - index);
 }
 
-static int qrgen_generate_QR (const unsigned char * data, unsigned short length, unsigned char version, unsigned char ECC, unsigned char * result) {
+static int qrgen_generate_QR (const unsigned char * data, unsigned short length, unsigned char version, unsigned char ECC,
+                              const struct qrgen_reference_frame * reference, unsigned char * result) {
   // returns 0 on success
   unsigned char buffer[QRGEN_ENCODING_BUFFER_SIZE];
   if (length > QRGEN_ENCODING_BUFFER_SIZE) return 1;
   int rv = qrgen_encode_QR_data(data, length, version, ECC, buffer);
   if (rv) return rv;
-  return qrgen_build_QR(buffer, version, ECC, result);
+  return qrgen_build_QR(buffer, version, ECC, reference, result);
 }
 
 static int qrgen_encode_QR_data (const unsigned char * data, unsigned short length, unsigned char version, unsigned char ECC, unsigned char * buffer) {
   unsigned char data_stream[QRGEN_ENCODING_BUFFER_SIZE];
   unsigned char ECC_stream[QRGEN_ENCODING_BUFFER_SIZE];
-  unsigned short limit = qrgen_maximum_data_length(version, ECC);
+  int rv = qrgen_fill_data_stream(data, length, qrgen_maximum_data_length(version, ECC), data_stream);
+  if (rv) return rv;
+  struct qrgen_ECC_parameters parameters = qrgen_calculate_ECC_parameters(version, ECC);
+  qrgen_generate_ECC_stream(data_stream, ECC_stream, parameters);
+  qrgen_interleave(data_stream, ECC_stream, parameters, buffer);
+  return 0;
+}
+
+static int qrgen_fill_data_stream (const unsigned char * data, unsigned short length, unsigned short limit, unsigned char * data_stream) {
   if (length > limit) return 2;
   memcpy(data_stream, data, length);
   unsigned char filler = 0xEC;
@@ -243,9 +480,6 @@ static int qrgen_encode_QR_data (const unsigned char * data, unsigned short leng
     data_stream[position] = filler;
     filler ^= 0xFD; // alternates between 0xEC and 0x11
   }
-  struct qrgen_ECC_parameters parameters = qrgen_calculate_ECC_parameters(version, ECC);
-  qrgen_generate_ECC_stream(data_stream, ECC_stream, parameters);
-  qrgen_interleave(data_stream, ECC_stream, parameters, buffer);
   return 0;
 }
 
@@ -326,23 +560,34 @@ static void qrgen_interleave (const unsigned char * data, const unsigned char *
     *(result ++) = ECC[block * parameters.ECC_bytes + pos];
 }
 
-static int qrgen_build_QR (const unsigned char * data, unsigned char version, unsigned char ECC, unsigned char * result) {
+static int qrgen_build_QR (const unsigned char * data, unsigned char version, unsigned char ECC, const struct qrgen_reference_frame * reference,
+                           unsigned char * result) {
   unsigned char modules[QRGEN_ENCODING_BUFFER_SIZE * 8L]; // index = col * side + row
   unsigned char side = version * 4 + 17;
-  memset(modules, QRGEN_EMPTY, side * side);
-  qrgen_place_function_patterns(modules, side, version);
-  qrgen_place_version_information(modules, side, version);
-  qrgen_place_format_information(modules, side, -1);
-  modules[9 * side - 8] = QRGEN_BLACK_NONMASKED;
+  qrgen_place_fixed_patterns(modules, side, version);
   qrgen_place_data_modules(modules, side, version, data);
   unsigned pos;
   for (pos = 0; pos < (side * side); pos ++) if (modules[pos] == QRGEN_EMPTY) return 3;
-  unsigned char masking = qrgen_select_masking(modules, side, ECC);
+  unsigned char masking;
+  if (reference)
+    masking = qrgen_select_masking_for_reference(modules, side, ECC, reference);
+  else
+    masking = qrgen_select_masking(modules, side, ECC);
+  if (masking > 7) return 4;
   qrgen_apply_masking(modules, side, masking, ECC);
   qrgen_export_QR_data(modules, side, result);
   return 0;
 }
 
+static void qrgen_place_fixed_patterns (unsigned char * modules, unsigned char side, unsigned char version) {
+  // everything except for the data modules; format information is only reserved, since it depends on the masking
+  memset(modules, QRGEN_EMPTY, side * side);
+  qrgen_place_function_patterns(modules, side, version);
+  qrgen_place_version_information(modules, side, version);
+  qrgen_place_format_information(modules, side, -1);
+  modules[9 * side - 8] = QRGEN_BLACK_NONMASKED;
+}
+
 static void qrgen_place_function_patterns (unsigned char * modules, unsigned char side, unsigned char version) {
   unsigned pos;
   qrgen_place_position_identification_pattern(modules, 0, 0, side);
@@ -495,6 +740,60 @@ static unsigned char qrgen_select_masking (unsigned char * modules, unsigned cha
   return best_masking;
 }
 
+static unsigned char qrgen_select_masking_for_reference (unsigned char * modules, unsigned char side, unsigned char ECC,
+                                                         const struct qrgen_reference_frame * reference) {
+  // start from the masking that qrgen_select_masking would pick, and only move away from it to a masking that changes fewer
+  // modules and whose penalty is at most the tolerance above that masking's penalty
+  unsigned char reference_modules[QRGEN_ENCODING_BUFFER_SIZE * 8L]; // same layout as modules
+  unsigned char version = (side - 17) >> 2;
+  unsigned char display_side = QR_PIXELS_PER_SIDE((reference->version > version) ? reference->version : version);
+  unsigned char row_data[QRGEN_DISPLAY_ROW_SIZE];
+  unsigned char offset = (display_side - side) >> 1;
+  unsigned char row, col;
+  for (row = 0; row < side; row ++) {
+    qrgen_load_display_row(reference->data, reference->version, display_side, row + offset, row_data);
+    for (col = 0; col < side; col ++)
+      reference_modules[col * side + row] = (row_data[(col + offset) >> 3] >> (7 - ((col + offset) & 7))) & 1;
+  }
+  unsigned scores[8], changes[8], penalty, default_penalty;
+  unsigned char masking, default_masking, best_masking, score, default_score;
+  for (masking = 0; masking < 8; masking ++) {
+    qrgen_apply_masking(modules, side, masking, ECC);
+    scores[masking] = qrgen_compute_masking_score(modules, side, masking);
+    changes[masking] = qrgen_count_changed_modules(modules, reference_modules, side);
+    qrgen_unmask(modules, side);
+  }
+  // the scores are compared as unsigned chars, exactly like in qrgen_select_masking, so that both pick the same default
+  default_masking = 0;
+  default_score = *scores;
+  for (masking = 1; masking < 8; masking ++) {
+    score = scores[masking];
+    if (score < default_score) {
+      default_masking = masking;
+      default_score = score;
+    }
+  }
+  default_penalty = scores[default_masking] >> 3;
+  best_masking = default_masking;
+  for (masking = 0; masking < 8; masking ++) {
+    if (masking == default_masking) continue;
+    penalty = scores[masking] >> 3;
+    // written as a subtraction so that it can't wrap around, even for huge tolerances
+    if ((penalty > default_penalty) && ((penalty - default_penalty) > reference->tolerance)) continue;
+    if (changes[masking] > changes[best_masking]) continue;
+    if ((changes[masking] == changes[best_masking]) && ((best_masking == default_masking) || (scores[masking] > scores[best_masking]))) continue;
+    best_masking = masking;
+  }
+  return best_masking;
+}
+
+static unsigned qrgen_count_changed_modules (const unsigned char * modules, const unsigned char * reference_modules, unsigned char side) {
+  unsigned short index, limit = (unsigned short) side * side;
+  unsigned count = 0;
+  for (index = 0; index < limit; index ++) count += (modules[index] ^ reference_modules[index]) & 1;
+  return count;
+}
+
 static void qrgen_apply_masking (unsigned char * modules, unsigned char side, unsigned char masking, unsigned char ECC) {
   // repeating the same body in each loop (to mask cells) isn't pretty, but it's more efficient than any alternative, and it's just one line
   qrgen_place_format_information(modules, side, qrgen_compute_format_information(ECC, masking));
@@ -593,8 +892,12 @@ static unsigned qrgen_compute_masking_score (unsigned char * modules, unsigned c
     if (adjacent > 5) score += adjacent - 2;
     adjacent = 0;
   }
+  return qrgen_finish_masking_score(score, masking);
+}
+
+static unsigned qrgen_finish_masking_score (unsigned score, unsigned char masking) {
   // add a tie-breaking criterion; prefer masking fewer cells, and if tied, simpler maskings
-  value = masking[(unsigned char []) {4, 3, 1, 2, 5, 0, 7, 6}];
+  unsigned char value = masking[(unsigned char []) {4, 3, 1, 2, 5, 0, 7, 6}];
   return (score << 3) | value;
 }
 
@@ -617,3 +920,380 @@ static void qrgen_export_QR_data (const unsigned char * modules, unsigned char s
     *(result ++) = value;
   }
 }
+
+static void qrgen_render_sheet_row (const unsigned char * codes, const unsigned char * versions, unsigned band, unsigned line,
+                                    struct QR_sheet_layout layout, unsigned char * row) {
+  // codes smaller than the largest version in range are centered in their cells; the size difference is always even
+  unsigned char max_version = (layout.target_version > layout.limit_version) ? layout.target_version : layout.limit_version;
+  unsigned cell = QR_SHEET_CELL_SIZE(max_version, layout.margin);
+  unsigned column, offset, side, start, end;
+  const unsigned char * code_row;
+  memset(row, 0, QR_SHEET_ROW_SIZE(max_version, layout.columns, layout.scale, layout.margin));
+  for (column = 0; column < band; column ++) {
+    side = QR_PIXELS_PER_SIDE(versions[column]);
+    offset = layout.margin + ((QR_PIXELS_PER_SIDE(max_version) - side) >> 1);
+    if ((line < offset) || (line >= (offset + side))) continue;
+    code_row = codes + (unsigned long) column * QR_BUFFER_SIZE(max_version) + (line - offset) * QR_BYTES_PER_ROW(versions[column]);
+    // fill whole runs of dark modules at once instead of going module by module
+    for (start = 0; start < side; start = end) {
+      while ((start < side) && !(code_row[start >> 3] & (0x80 >> (start & 7)))) start ++;
+      for (end = start; (end < side) && (code_row[end >> 3] & (0x80 >> (end & 7))); end ++);
+      if (end > start)
+        qrgen_fill_pixels(row, ((unsigned long) column * cell + offset + start) * layout.scale, (unsigned long) (end - start) * layout.scale);
+    }
+  }
+}
+
+static void qrgen_fill_pixels (unsigned char * row, unsigned long position, unsigned long length) {
+  // sets the bits for pixels position to position + length - 1; MSB = leftmost pixel, like in the code buffers
+  unsigned char * current = row + (position >> 3);
+  unsigned char head = position & 7;
+  if ((head + length) <= 8) {
+    *current |= (0xFF >> head) & (0xFF << (8 - head - length));
+    return;
+  }
+  if (head) {
+    *(current ++) |= 0xFF >> head;
+    length -= 8 - head;
+  }
+  memset(current, 0xFF, length >> 3);
+  current += length >> 3;
+  if (length & 7) *current |= 0xFF << (8 - (length & 7));
+}
+
+static void qrgen_load_display_row (const unsigned char * code, unsigned char version, unsigned char display_side, unsigned char row,
+                                    unsigned char * result) {
+  // loads a row of a display area of display_side modules per side, with the code centered in it; version 0 is an empty display
+  // the result uses the same format as the rows in a code buffer, with all padding bits cleared
+  memset(result, 0, QRGEN_DISPLAY_ROW_SIZE);
+  if (!version) return;
+  unsigned char side = QR_PIXELS_PER_SIDE(version);
+  unsigned char offset = (display_side - side) >> 1;
+  if ((row < offset) || (row >= (offset + side))) return;
+  const unsigned char * source = code + (row - offset) * QR_BYTES_PER_ROW(version);
+  unsigned char shift = offset & 7, pos, value;
+  result += offset >> 3;
+  for (pos = 0; pos < QR_BYTES_PER_ROW(version); pos ++) {
+    value = source[pos];
+    if (pos == (QR_BYTES_PER_ROW(version) - 1)) value &= 0xFF << (8 - (side & 7));
+    result[pos] |= value >> shift;
+    if (shift) result[pos + 1] |= value << (8 - shift);
+  }
+}
+
+static unsigned char qrgen_load_display_difference (const unsigned char * previous, unsigned char previous_version, const unsigned char * next,
+                                                    unsigned char next_version, unsigned char row, unsigned char * result) {
+  // returns whether there are any changes in the row at all
+  unsigned char next_row[QRGEN_DISPLAY_ROW_SIZE];
+  unsigned char side = QR_PIXELS_PER_SIDE((previous_version > next_version) ? previous_version : next_version);
+  unsigned char pos, changed = 0;
+  qrgen_load_display_row(previous, previous_version, side, row, result);
+  qrgen_load_display_row(next, next_version, side, row, next_row);
+  for (pos = 0; pos < QRGEN_DISPLAY_ROW_SIZE; pos ++) changed |= result[pos] ^= next_row[pos];
+  return changed;
+}
+
+static unsigned char qrgen_next_changed_run (const unsigned char * row, unsigned char side, unsigned char * col, unsigned char * width) {
+  // finds the first run of set bits in the row starting at *col; returns 0 if there are none
+  unsigned char pos = *col;
+  while ((pos < side) && !(row[pos >> 3] & (0x80 >> (pos & 7))))
+    if (row[pos >> 3] & (0xFF >> (pos & 7)))
+      pos ++;
+    else
+      pos = (pos | 7) + 1; // nothing left in this byte, so skip to the next one
+  if (pos >= side) return 0;
+  *col = pos;
+  while ((pos < side) && (row[pos >> 3] & (0x80 >> (pos & 7)))) pos ++;
+  *width = pos - *col;
+  return 1;
+}
+
+static int qrgen_tile_is_dirty (const unsigned char * row, unsigned char side, unsigned char col, unsigned char tile_size) {
+  unsigned char width, pos = col;
+  if (!qrgen_next_changed_run(row, side, &pos, &width)) return 0;
+  return (pos - col) < tile_size;
+}
+
+static int qrgen_generate_sliced_QR_codes (const void * const * data, const unsigned short * lengths, const unsigned * lanes, unsigned char lane_count,
+                                           unsigned char target_version, unsigned char limit_version, unsigned char selection, void * const * buffers) {
+  // bit-sliced version of qrgen_generate_QR: bit k of every unsigned long long belongs to the code given by lanes[k]
+  // all codes must use the same parameters (given by selection, like the result of qrgen_select_parameters)
+  // returns 0 on success; on failure, nothing is written, and the codes can still be generated one by one
+  unsigned char version = selection >> 2, ECC = selection & 3;
+  unsigned short codewords = qrgen_data_bits_for_version(version) >> 3;
+  unsigned short area = QR_PIXELS_PER_SIDE(version) * QR_PIXELS_PER_SIDE(version);
+  // the encoded data is followed by a workspace for the encoder (which needs room for its 8 words per codeword) and the builder
+  // (which needs room for two words and two bytes per module); since there are 8 modules per codeword, the latter is always larger
+  unsigned long long * buffer = malloc(sizeof(unsigned long long) * (codewords * 8 + area * 2) + area * 2);
+  if (!buffer) return 4;
+  int rv = qrgen_encode_sliced_QR_data(data, lengths, lanes, lane_count, target_version, limit_version, version, ECC, buffer + codewords * 8, buffer);
+  if (!rv) rv = qrgen_build_sliced_QR(buffer, version, ECC, lane_count, buffer + codewords * 8, buffers, lanes);
+  free(buffer);
+  return rv;
+}
+
+static int qrgen_encode_sliced_QR_data (const void * const * data, const unsigned short * lengths, const unsigned * lanes, unsigned char lane_count,
+                                        unsigned char target_version, unsigned char limit_version, unsigned char version, unsigned char ECC,
+                                        unsigned long long * workspace, unsigned long long * result) {
+  // bit-sliced version of qrgen_encode_QR_data; every codeword takes 8 words, one per bit, starting from the least significant
+  unsigned char encoding_buffer[QRGEN_ENCODING_BUFFER_SIZE * 3];
+  unsigned char data_stream[QRGEN_ENCODING_BUFFER_SIZE];
+  unsigned short encoded_lengths[3];
+  unsigned short limit = qrgen_maximum_data_length(version, ECC), position;
+  unsigned char lane, bit, kind = (version > 9) + (version > 26);
+  int rv;
+  memset(workspace, 0, sizeof *workspace * limit * 8);
+  for (lane = 0; lane < lane_count; lane ++) {
+    // the encoded data isn't kept from the initial selection, so it must be encoded again
+    qrgen_encode_and_select(data[lanes[lane]], lengths[lanes[lane]], target_version, limit_version, encoding_buffer, encoded_lengths);
+    rv = qrgen_fill_data_stream(encoding_buffer + QRGEN_ENCODING_BUFFER_SIZE * kind, encoded_lengths[kind], limit, data_stream);
+    if (rv) return rv;
+    for (position = 0; position < limit; position ++) for (bit = 0; bit < 8; bit ++)
+      if (data_stream[position] & (1 << bit)) workspace[position * 8 + bit] |= 1ULL << lane;
+  }
+  struct qrgen_ECC_parameters parameters = qrgen_calculate_ECC_parameters(version, ECC);
+  qrgen_generate_sliced_ECC_stream(workspace, workspace + limit * 8, parameters);
+  qrgen_interleave_sliced(workspace, workspace + limit * 8, parameters, result);
+  return 0;
+}
+
+static void qrgen_generate_sliced_ECC_stream (const unsigned long long * data, unsigned long long * output, struct qrgen_ECC_parameters parameters) {
+  // multiplying by a constant is linear over the bits of the other factor, so multiplying a bit-sliced codeword by a polynomial
+  // coefficient only needs the products of that coefficient and each single bit; precompute them once for all blocks
+  unsigned char polynomial[32], products[32][8];
+  unsigned block, length, pos, bit;
+  qrgen_generate_ECC_polynomial(parameters.ECC_bytes, polynomial);
+  for (pos = 0; pos < parameters.ECC_bytes; pos ++) for (bit = 0; bit < 8; bit ++)
+    products[pos][bit] = qrgen_ECC_multiply(polynomial[pos], 1 << bit);
+  for (block = 0; block < parameters.blocks; block ++) {
+    length = parameters.data_bytes - (block < parameters.short_blocks);
+    qrgen_generate_sliced_ECC_data(data, length, output, parameters.ECC_bytes, products);
+    data += length * 8;
+    output += parameters.ECC_bytes * 8;
+  }
+}
+
+static void qrgen_generate_sliced_ECC_data (const unsigned long long * data, unsigned char length, unsigned long long * output, unsigned char output_length,
+                                            unsigned char (* products)[8]) {
+  unsigned long long input[8];
+  unsigned char pos, index, bit, product, target;
+  memset(output, 0, sizeof *output * output_length * 8);
+  for (pos = 0; pos < length; pos ++) {
+    for (bit = 0; bit < 8; bit ++) input[bit] = data[pos * 8 + bit] ^ output[bit];
+    memmove(output, output + 8, sizeof *output * (output_length - 1) * 8);
+    memset(output + (output_length - 1) * 8, 0, sizeof *output * 8);
+    for (index = 0; index < output_length; index ++) for (bit = 0; bit < 8; bit ++)
+      for (product = products[output_length - 1 - index][bit], target = 0; product; product >>= 1, target ++)
+        if (product & 1) output[index * 8 + target] ^= input[bit];
+  }
+}
+
+static void qrgen_interleave_sliced (const unsigned long long * data, const unsigned long long * ECC, struct qrgen_ECC_parameters parameters,
+                                     unsigned long long * result) {
+  const unsigned long long * blocks[84]; // enough for the largest case
+  unsigned block, pos;
+  *blocks = data;
+  for (block = 0; block < parameters.blocks; block ++)
+    blocks[block + 1] = blocks[block] + (parameters.data_bytes - (block < parameters.short_blocks)) * 8;
+  for (pos = 0; pos < parameters.data_bytes; pos ++) for (block = 0; block < parameters.blocks; block ++) {
+    if ((blocks[block] + pos * 8) >= blocks[block + 1]) continue;
+    memcpy(result, blocks[block] + pos * 8, sizeof *result * 8);
+    result += 8;
+  }
+  for (pos = 0; pos < parameters.ECC_bytes; pos ++) for (block = 0; block < parameters.blocks; block ++) {
+    memcpy(result, ECC + (block * parameters.ECC_bytes + pos) * 8, sizeof *result * 8);
+    result += 8;
+  }
+}
+
+static int qrgen_build_sliced_QR (const unsigned long long * data, unsigned char version, unsigned char ECC, unsigned char lane_count,
+                                  unsigned long long * workspace, void * const * buffers, const unsigned * lanes) {
+  // the module template is shared by all codes: it contains the function patterns, like in qrgen_build_QR, and all data modules
+  // are white, so that applying a masking to it shows which data modules that masking flips
+  unsigned char side = version * 4 + 17;
+  unsigned short pos, area = (unsigned short) side * side;
+  unsigned long long * modules = workspace;
+  unsigned long long * masked = modules + area;
+  unsigned char * module_template = (unsigned char *) (masked + area);
+  unsigned char * masked_template = module_template + area;
+  unsigned long long selected_lanes[8];
+  unsigned char masking;
+  qrgen_place_fixed_patterns(module_template, side, version);
+  for (pos = 0; pos < area; pos ++) modules[pos] = (module_template[pos] & 1) ? QRGEN_ALL_SLICED_LANES : 0;
+  qrgen_place_sliced_data_modules(module_template, modules, side, version, data);
+  for (pos = 0; pos < area; pos ++) if (module_template[pos] == QRGEN_EMPTY) return 3;
+  qrgen_select_sliced_masking(module_template, masked_template, modules, masked, side, ECC, lane_count, selected_lanes);
+  for (masking = 0; masking < 8; masking ++) {
+    if (!selected_lanes[masking]) continue;
+    memcpy(masked_template, module_template, area);
+    qrgen_apply_masking(masked_template, side, masking, ECC);
+    qrgen_apply_sliced_masking(masked_template, modules, side, selected_lanes[masking], masked);
+  }
+  qrgen_export_sliced_QR_data(masked, side, buffers, lanes, lane_count);
+  return 0;
+}
+
+static void qrgen_place_sliced_data_modules (unsigned char * modules, unsigned long long * sliced_modules, unsigned char side, unsigned char version,
+                                             const unsigned long long * data) {
+  // data modules are marked as white in modules (the shared template), and their actual values go into sliced_modules
+  unsigned short length;
+  unsigned short scan, index = 0;
+  unsigned char bit;
+  for (length = qrgen_data_bits_for_version(version); length > 7; length -= 8) {
+    for (bit = 7; bit < 8; bit --) {
+      do
+        scan = qrgen_scan_index(index ++, side);
+      while (modules[scan] != QRGEN_EMPTY);
+      modules[scan] = QRGEN_WHITE;
+      sliced_modules[scan] = data[bit];
+    }
+    data += 8;
+  }
+  while (length --) {
+    do
+      scan = qrgen_scan_index(index ++, side);
+    while (modules[scan] != QRGEN_EMPTY);
+    modules[scan] = QRGEN_WHITE;
+    sliced_modules[scan] = 0;
+  }
+}
+
+static void qrgen_select_sliced_masking (const unsigned char * module_template, unsigned char * masked_template, const unsigned long long * modules,
+                                         unsigned long long * masked, unsigned char side, unsigned char ECC, unsigned char lane_count,
+                                         unsigned long long * selected_lanes) {
+  // selected_lanes[masking] receives the lanes that use each masking
+  // the scores are kept in unsigned chars, exactly like in qrgen_select_masking, so that both always select the same masking
+  unsigned char scores[8][QRGEN_SLICED_LANES], masking, best_masking, best_score, lane;
+  for (masking = 0; masking < 8; masking ++) {
+    memcpy(masked_template, module_template, (unsigned short) side * side);
+    qrgen_apply_masking(masked_template, side, masking, ECC);
+    qrgen_apply_sliced_masking(masked_template, modules, side, QRGEN_ALL_SLICED_LANES, masked);
+    qrgen_compute_sliced_masking_scores(masked, side, masking, lane_count, scores[masking]);
+    selected_lanes[masking] = 0;
+  }
+  for (lane = 0; lane < lane_count; lane ++) {
+    best_masking = 0;
+    best_score = scores[0][lane];
+    for (masking = 1; masking < 8; masking ++) if (scores[masking][lane] < best_score) {
+      best_masking = masking;
+      best_score = scores[masking][lane];
+    }
+    selected_lanes[best_masking] |= 1ULL << lane;
+  }
+}
+
+static void qrgen_apply_sliced_masking (const unsigned char * masked_template, const unsigned long long * modules, unsigned char side,
+                                        unsigned long long lanes, unsigned long long * result) {
+  // masked_template is the module template after applying the masking to it; only the given lanes are written to the result
+  unsigned short index, limit = (unsigned short) side * side;
+  unsigned long long value;
+  for (index = 0; index < limit; index ++) {
+    if (masked_template[index] == QRGEN_WHITE)
+      value = modules[index];
+    else if (masked_template[index] == QRGEN_BLACK_WITHMASK)
+      value = ~modules[index];
+    else
+      value = (masked_template[index] & 1) ? QRGEN_ALL_SLICED_LANES : 0;
+    result[index] = (result[index] & ~lanes) | (value & lanes);
+  }
+}
+
+static void qrgen_compute_sliced_masking_scores (const unsigned long long * modules, unsigned char side, unsigned char masking, unsigned char lane_count,
+                                                 unsigned char * scores) {
+  // bit-sliced version of qrgen_compute_masking_score; instead of adding up penalties, it counts the events that cause them in
+  // bit-sliced counters (bit k of counters[event][n] is bit n of the count for lane k) and converts them into penalties at the end
+  // a run of N >= 7 modules scores N - 3, which is counted as N - 6 run modules plus one run worth 3 points
+  unsigned long long counters[QRGEN_EVENT_COUNT][16];
+  unsigned char pos, lane;
+  unsigned score, black;
+  memset(counters, 0, sizeof counters);
+  for (pos = 0; pos < side; pos ++) {
+    qrgen_count_sliced_line_penalties(modules + pos * side, pos ? modules + (pos - 1) * side : NULL, 1, side, 1, counters);
+    qrgen_count_sliced_line_penalties(modules + pos, NULL, side, side, 0, counters);
+  }
+  for (lane = 0; lane < lane_count; lane ++) {
+    score = qrgen_read_sliced_counter(counters[QRGEN_EVENT_RUN_MODULES], lane) + 3 * qrgen_read_sliced_counter(counters[QRGEN_EVENT_RUNS], lane);
+    score += 40 * qrgen_read_sliced_counter(counters[QRGEN_EVENT_PATTERNS], lane) + 3 * qrgen_read_sliced_counter(counters[QRGEN_EVENT_BLOCKS], lane);
+    black = (400u * qrgen_read_sliced_counter(counters[QRGEN_EVENT_BLACK], lane) + 200u) / (side * side);
+    if (black > 100) score += black - 100;
+    scores[lane] = qrgen_finish_masking_score(score, masking);
+  }
+}
+
+static void qrgen_count_sliced_line_penalties (const unsigned long long * line, const unsigned long long * previous_line, unsigned short step,
+                                               unsigned char side, int count_area, unsigned long long (* counters)[16]) {
+  // counts the events for a single row or column, whose modules are step words apart; area events (dark modules and 2x2 blocks,
+  // which need the previous line) are only counted if count_area is set, so that they are only counted for one direction
+  // window[6] is the current module and window[0] the one 6 positions before it; longer[n] marks the lanes where the current run
+  // is at least n modules long
+  unsigned long long window[7] = {0}, longer[9] = {0};
+  unsigned char pos, length;
+  for (pos = 0; pos < side; pos ++) {
+    memmove(window, window + 1, sizeof *window * 6);
+    window[6] = line[pos * step];
+    if (count_area) {
+      qrgen_add_to_sliced_counter(counters[QRGEN_EVENT_BLACK], window[6]);
+      if (previous_line && pos)
+        qrgen_add_to_sliced_counter(counters[QRGEN_EVENT_BLOCKS],
+                                    ~((window[6] ^ window[5]) | (window[6] ^ previous_line[pos]) | (window[6] ^ previous_line[pos - 1])));
+    }
+    if (!pos) continue;
+    for (length = 8; length > 2; length --) longer[length] = longer[length - 1] & ~(window[6] ^ window[5]);
+    longer[2] = ~(window[6] ^ window[5]);
+    qrgen_add_to_sliced_counter(counters[QRGEN_EVENT_RUN_MODULES], longer[7]);
+    qrgen_add_to_sliced_counter(counters[QRGEN_EVENT_RUNS], longer[7] & ~longer[8]);
+    if (pos >= 6)
+      qrgen_add_to_sliced_counter(counters[QRGEN_EVENT_PATTERNS], (window[0] & window[2] & window[3] & window[4] & window[6]) | ~(window[1] | window[5]));
+  }
+}
+
+static void qrgen_add_to_sliced_counter (unsigned long long * counter, unsigned long long value) {
+  // adds 1 to the count of every lane set in value; counts never exceed 2 * 177 * 177, so 16 bits are enough
+  unsigned long long carry;
+  unsigned char bit;
+  for (bit = 0; value && (bit < 16); bit ++) {
+    carry = counter[bit] & value;
+    counter[bit] ^= value;
+    value = carry;
+  }
+}
+
+static unsigned qrgen_read_sliced_counter (const unsigned long long * counter, unsigned char lane) {
+  unsigned result = 0;
+  unsigned char bit;
+  for (bit = 0; bit < 16; bit ++) result |= (unsigned) ((counter[bit] >> lane) & 1) << bit;
+  return result;
+}
+
+static void qrgen_export_sliced_QR_data (const unsigned long long * modules, unsigned char side, void * const * buffers, const unsigned * lanes,
+                                         unsigned char lane_count) {
+  // bit-sliced version of qrgen_export_QR_data: transposing a block of 64 modules of a row (one word each) gives 64 words,
+  // each one containing those modules for a single code, already in export order (MSB = leftmost module)
+  unsigned long long block[QRGEN_SLICED_LANES];
+  unsigned char row, col, pos, lane, count, bytes = (side >> 3) + 1;
+  unsigned char * output;
+  for (row = 0; row < side; row ++) for (col = 0; col < side; col += QRGEN_SLICED_LANES) {
+    for (pos = 0; pos < QRGEN_SLICED_LANES; pos ++)
+      block[pos] = ((col + pos) < side) ? modules[(col + pos) * side + row] & QRGEN_ALL_SLICED_LANES : 0;
+    qrgen_transpose_sliced_block(block);
+    count = bytes - (col >> 3);
+    if (count > 8) count = 8;
+    for (lane = 0; lane < lane_count; lane ++) {
+      output = (unsigned char *) buffers[lanes[lane]] + row * bytes + (col >> 3);
+      for (pos = 0; pos < count; pos ++) output[pos] = block[QRGEN_SLICED_LANES - 1 - lane] >> (56 - 8 * pos);
+    }
+  }
+}
+
+static void qrgen_transpose_sliced_block (unsigned long long * block) {
+  // transposes a 64x64 bit matrix in place, where bit 63 - col of block[row] is the element at (row, col)
+  // this swaps the off-diagonal quadrants of every 2^n x 2^n submatrix, from n = 5 down to 0
+  unsigned long long mask = 0xFFFFFFFFULL, swap;
+  unsigned char width, row;
+  for (width = 32; width; width >>= 1, mask ^= mask << width)
+    for (row = 0; row < 64; row = ((row | width) + 1) & ~width) {
+      swap = (block[row] ^ (block[row | width] >> width)) & mask;
+      block[row] ^= swap;
+      block[row | width] ^= swap << width;
+    }
+}
@@ -12,11 +12,43 @@
 #define QR_BYTES_PER_ROW(version) ((QR_PIXELS_PER_SIDE(version) >> 3) + 1)
 #define QR_BUFFER_SIZE(version) (QR_PIXELS_PER_SIDE(version) * QR_BYTES_PER_ROW(version))
 
+#define QR_SHEET_CELL_SIZE(version, margin) (QR_PIXELS_PER_SIDE(version) + ((margin) << 1))
+#define QR_SHEET_ROW_SIZE(version, columns, scale, margin) \
+  (((unsigned long) (columns) * QR_SHEET_CELL_SIZE(version, margin) * (scale) + 7) >> 3)
+#define QR_SHEET_BUFFER_SIZE(version, columns, scale, margin) \
+  ((unsigned long) (columns) * (QR_BUFFER_SIZE(version) + 1) + QR_SHEET_ROW_SIZE(version, columns, scale, margin))
+
 #ifdef __cplusplus
   extern "C" {
 #endif
 
+struct QR_sheet_layout {
+  unsigned columns;
+  unsigned char target_version;
+  unsigned char limit_version;
+  unsigned char scale;
+  unsigned char margin;
+};
+
+struct QR_change {
+  unsigned char row;
+  unsigned char col;
+  unsigned char height;
+  unsigned char width;
+};
+
 unsigned char generate_QR_code(const void * data, unsigned short length, unsigned char target_version, unsigned char limit_version, void * buffer);
+unsigned char select_QR_version(const void * data, unsigned short length, unsigned char target_version, unsigned char limit_version);
+unsigned char generate_QR_code_update(const void * data, unsigned short length, unsigned char target_version, unsigned char limit_version,
+                                      const void * previous, unsigned char previous_version, unsigned tolerance, void * buffer);
+unsigned generate_QR_codes(const void * const * data, const unsigned short * lengths, unsigned count, unsigned char target_version,
+                           unsigned char limit_version, void * const * buffers, unsigned char * versions);
+unsigned render_QR_sheet(const void * const * data, const unsigned short * lengths, unsigned count, struct QR_sheet_layout layout,
+                         void (* emit_row) (const void *, void *), void * context, void * buffer);
+unsigned diff_QR_spans(const void * previous, unsigned char previous_version, const void * next, unsigned char next_version,
+                       struct QR_change * changes, unsigned max_changes);
+unsigned diff_QR_rectangles(const void * previous, unsigned char previous_version, const void * next, unsigned char next_version,
+                            unsigned char tile_size, struct QR_change * changes, unsigned max_changes);
 
 #ifdef __cplusplus
   }
@@ -0,0 +1,204 @@
+#ifndef ___LIB_QRGEN_HPP
+
+#define ___LIB_QRGEN_HPP 1
+
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+
+#include "libqrgen.h"
+
+namespace qrgen {
+  enum class errc {
+    invalid_version = 1,
+    data_too_long
+  };
+
+  class error_category_type : public std::error_category {
+  public:
+    const char * name () const noexcept override {
+      return "qrgen";
+    }
+
+    std::string message (int value) const override {
+      switch (static_cast<errc>(value)) {
+        case errc::invalid_version:
+          return "version numbers must be between 1 and 40";
+        case errc::data_too_long:
+          return "data doesn't fit in any version within the range";
+      }
+      return "unknown error";
+    }
+  };
+
+  inline const std::error_category & error_category () noexcept {
+    static const error_category_type category;
+    return category;
+  }
+
+  inline std::error_code make_error_code (errc value) noexcept {
+    return std::error_code(static_cast<int>(value), error_category());
+  }
+}
+
+namespace std {
+  template <> struct is_error_code_enum<qrgen::errc> : true_type {};
+}
+
+namespace qrgen {
+  // codes up to inline_version are stored inside the object itself; larger ones are allocated from a memory resource
+  template <unsigned char inline_version = 10> class basic_qr_code {
+    static_assert((inline_version >= 1) && (inline_version <= 40), "the inline version must be between 1 and 40");
+
+  public:
+    basic_qr_code () noexcept = default;
+    basic_qr_code (const basic_qr_code &) = delete;
+    basic_qr_code & operator = (const basic_qr_code &) = delete;
+
+    basic_qr_code (basic_qr_code && other) noexcept {
+      take(other);
+    }
+
+    basic_qr_code & operator = (basic_qr_code && other) noexcept {
+      if (this != &other) {
+        release();
+        take(other);
+      }
+      return *this;
+    }
+
+    ~basic_qr_code () {
+      release();
+    }
+
+    // on failure, these return an empty code (i.e., with a version of 0) and set the error
+    static basic_qr_code generate (std::span<const std::byte> data, unsigned char target_version, unsigned char limit_version,
+                                   std::error_code & error, std::pmr::memory_resource * resource = std::pmr::get_default_resource()) noexcept {
+      basic_qr_code result;
+      error.clear();
+      if ((target_version < 1) || (target_version > 40) || (limit_version < 1) || (limit_version > 40)) {
+        error = errc::invalid_version;
+        return result;
+      }
+      unsigned char version = 0;
+      if (data.size() <= std::numeric_limits<unsigned short>::max())
+        version = select_QR_version(data.data(), data.size(), target_version, limit_version);
+      if (!version) {
+        error = errc::data_too_long;
+        return result;
+      }
+      unsigned char * buffer = result.inline_storage;
+      if (version > inline_version) {
+        try {
+          buffer = static_cast<unsigned char *>(resource->allocate(QR_BUFFER_SIZE(version), 1));
+        } catch (const std::bad_alloc &) {
+          error = std::make_error_code(std::errc::not_enough_memory);
+          return result;
+        }
+      }
+      // the selected version is the only candidate, so generating it again selects the same parameters
+      if (!generate_QR_code(data.data(), data.size(), version, version, buffer)) {
+        if (buffer != result.inline_storage) resource->deallocate(buffer, QR_BUFFER_SIZE(version), 1);
+        error = errc::data_too_long;
+        return result;
+      }
+      result.code_version = version;
+      if (buffer != result.inline_storage) {
+        result.heap_storage = buffer;
+        result.resource = resource;
+      }
+      return result;
+    }
+
+    static basic_qr_code generate (std::string_view data, unsigned char target_version, unsigned char limit_version, std::error_code & error,
+                                   std::pmr::memory_resource * resource = std::pmr::get_default_resource()) noexcept {
+      return generate(std::as_bytes(std::span(data)), target_version, limit_version, error, resource);
+    }
+
+    // these throw std::system_error on failure
+    static basic_qr_code generate (std::span<const std::byte> data, unsigned char target_version, unsigned char limit_version,
+                                   std::pmr::memory_resource * resource = std::pmr::get_default_resource()) {
+      std::error_code error;
+      basic_qr_code result = generate(data, target_version, limit_version, error, resource);
+      if (error) throw std::system_error(error);
+      return result;
+    }
+
+    static basic_qr_code generate (std::string_view data, unsigned char target_version, unsigned char limit_version,
+                                   std::pmr::memory_resource * resource = std::pmr::get_default_resource()) {
+      return generate(std::as_bytes(std::span(data)), target_version, limit_version, resource);
+    }
+
+    unsigned char version () const noexcept {
+      return code_version;
+    }
+
+    explicit operator bool () const noexcept {
+      return code_version;
+    }
+
+    bool is_inline () const noexcept {
+      return !heap_storage;
+    }
+
+    unsigned side () const noexcept {
+      return code_version ? QR_PIXELS_PER_SIDE(code_version) : 0;
+    }
+
+    std::size_t bytes_per_row () const noexcept {
+      return code_version ? QR_BYTES_PER_ROW(code_version) : 0;
+    }
+
+    // same layout as the buffer written by generate_QR_code
+    std::span<const unsigned char> data () const noexcept {
+      return std::span<const unsigned char>(storage(), code_version ? QR_BUFFER_SIZE(code_version) : 0);
+    }
+
+    std::span<const unsigned char> row (unsigned index) const noexcept {
+      return data().subspan(index * bytes_per_row(), bytes_per_row());
+    }
+
+    bool module (unsigned row, unsigned col) const noexcept {
+      return (storage()[row * bytes_per_row() + (col >> 3)] >> (7 - (col & 7))) & 1;
+    }
+
+  private:
+    unsigned char inline_storage[QR_BUFFER_SIZE(inline_version)];
+    unsigned char * heap_storage = nullptr;
+    std::pmr::memory_resource * resource = nullptr;
+    unsigned char code_version = 0;
+
+    const unsigned char * storage () const noexcept {
+      return heap_storage ? heap_storage : inline_storage;
+    }
+
+    void take (basic_qr_code & other) noexcept {
+      // inline codes only copy the bytes they actually use
+      code_version = other.code_version;
+      heap_storage = other.heap_storage;
+      resource = other.resource;
+      if (!heap_storage && code_version) std::memcpy(inline_storage, other.inline_storage, QR_BUFFER_SIZE(code_version));
+      other.code_version = 0;
+      other.heap_storage = nullptr;
+      other.resource = nullptr;
+    }
+
+    void release () noexcept {
+      if (heap_storage) resource->deallocate(heap_storage, QR_BUFFER_SIZE(code_version), 1);
+      heap_storage = nullptr;
+      resource = nullptr;
+      code_version = 0;
+    }
+  };
+
+  using qr_code = basic_qr_code<>;
+}
+
+#endif